@@ -41,12 +41,67 @@ namespace adif
     Document(const rapidcsv::Document &doc);
     // void Display(std::ostream &os = std::cout);
     void Open(const std::string &filename);
+    struct Report
+    {
+      std::string filename;
+      unsigned records;
+      unsigned duplicates;
+    };
+    /**
+     * @brief Open all ADIF files in a directory or matching a glob pattern
+     *
+     * Files are loaded concurrently, then merged in filename order. Records
+     * whose primary key (QSO_DATE, TIME_ON) appears in an earlier file are
+     * dropped; repeated keys within one file are kept, as Open does.
+     *
+     * @param pattern directory, or path whose last component may contain * and ?
+     * @return std::vector<Report> number of records read and dropped per file
+     */
+    std::vector<Report> OpenAll(const std::string &pattern);
     void Clean();
     rapidcsv::Document GetCSV() const;
     void Save(const std::string &filename) const;
+    void Export(const std::string &filename) const;
     void Merge(const Document &doc);
     using Conflict = std::pair<std::vector<int>, std::vector<int>>;
     Conflict DetectConflicts(const Document &doc) const;
+    /**
+     * @brief Detect conflicts between two ADIF files without loading them
+     *
+     * Primary keys (QSO_DATE, TIME_ON) of both files are streamed into sorted
+     * runs spilled to temporary files, then combined with a k-way merge. The
+     * result equals Document(lhs).DetectConflicts(Document(rhs)).
+     *
+     * @param lhs file whose indexes form Conflict::first
+     * @param rhs file whose indexes form Conflict::second
+     * @param memory_budget bytes of keys buffered before spilling a run, at
+     * least 512
+     * @return Conflict conflicting record indexes
+     */
+    static Conflict DetectConflicts(const std::string &lhs, const std::string &rhs, size_t memory_budget);
+    /**
+     * @brief Merge two ADIF files into output without loading them
+     *
+     * Conflicts are detected as by the static DetectConflicts, and the
+     * conflicting records of rhs are dropped from the output. output is written
+     * to a temporary file first and then renamed, so it may name an input.
+     *
+     * @return Conflict conflicting record indexes
+     * @throw std::runtime_error if an input is missing, corrupted or truncated,
+     * or output cannot be written; output is left untouched in that case
+     */
+    static Conflict Merge(const std::string &lhs, const std::string &rhs, const std::string &output, size_t memory_budget);
+    /**
+     * @brief Detect records that are likely the same QSO
+     *
+     * Records with the same CALL, BAND and MODE whose (QSO_DATE, TIME_ON) lie
+     * within window seconds of each other are clustered together. Records are
+     * bucketed by time window so only neighbouring buckets are compared.
+     *
+     * @param window maximum time difference in seconds, 0 for exact matches
+     * @return std::vector<std::vector<int>> clusters of ascending indexes
+     */
+    std::vector<std::vector<int>> DetectDuplicates(unsigned window) const;
     friend std::ostream &operator<<(std::ostream &os, const Document &doc);
     Record operator[](int index) const;
     using Fields = std::vector<std::pair<std::string, std::string>>;
@@ -54,6 +109,31 @@ namespace adif
     void Update(int index, const Fields &fields);
     void Delete(std::vector<int>);
     std::vector<std::vector<std::string>> GetTable() const;
+    /**
+     * @brief Statistics of one group of records sharing the same key values
+     *
+     * count is the number of records in the group, distinct and range hold the
+     * distinct values and the (min, max) pair of each aggregated field. Values
+     * are compared as strings, records lacking a field are not counted for it.
+     */
+    struct Group
+    {
+      unsigned count = 0;
+      std::map<std::string, std::set<std::string>> distinct;
+      std::map<std::string, std::pair<std::string, std::string>> range;
+    };
+    using Statistics = std::map<std::vector<std::string>, Group>;
+    /**
+     * @brief Group records by key fields and aggregate the given fields
+     *
+     * Records are scanned in a single parallel pass, each thread filling its
+     * own hash table which are merged at the end.
+     *
+     * @param keys fields to group by, a missing key field groups as ""
+     * @param fields fields to compute distinct count and min/max for
+     * @return Statistics groups ordered by key values
+     */
+    Statistics Aggregate(const std::vector<std::string> &keys, const std::vector<std::string> &fields = {}) const;
 
   private:
     std::string filename;
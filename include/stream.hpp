@@ -0,0 +1,55 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace adif
+{
+  /**
+   * @brief Open a file for reading, transparently decompressing gzip or zstd
+   *
+   * Compression is detected by magic bytes. Compressed content is decoded in
+   * a background thread which feeds the returned stream chunk by chunk.
+   *
+   * @param filename file to read
+   * @return std::unique_ptr<std::istream> stream, in failed state if the file
+   * cannot be opened or its compression is not supported by this build
+   */
+  std::unique_ptr<std::istream> openInput(const std::string &filename);
+
+  /**
+   * @brief Check a stream returned by openInput after reading it
+   *
+   * @param is stream returned by openInput
+   * @param filename file name used in the error message
+   * @throw std::runtime_error if reading failed or the compressed content
+   * was corrupted or truncated
+   */
+  void closeInput(std::istream &is, const std::string &filename);
+
+  /**
+   * @brief Open a file for writing, compressing if the extension is .gz or .zst
+   *
+   * Call closeOutput to finish the compressed stream and check for errors.
+   * Otherwise it is finished when the returned stream is destroyed, where
+   * failures can only be printed.
+   *
+   * @param filename file to write
+   * @return std::unique_ptr<std::ostream> stream, in failed state if the file
+   * cannot be opened
+   * @throw std::runtime_error if the extension asks for gzip or zstd but its
+   * support is not compiled in; the file is not touched in that case
+   */
+  std::unique_ptr<std::ostream> openOutput(const std::string &filename);
+
+  /**
+   * @brief Finish and close a stream returned by openOutput
+   *
+   * @param os stream returned by openOutput
+   * @param filename file name used in the error message
+   * @throw std::runtime_error if any write, compression or close failed
+   */
+  void closeOutput(std::ostream &os, const std::string &filename);
+
+} // namespace adif
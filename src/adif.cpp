@@ -1,12 +1,20 @@
 #include "adif.hpp"
+#include "stream.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
 #include <ios>
 #include <istream>
 #include <fstream>
+#include <functional>
 #include <limits>
 #include <string>
 #include <map>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace adif
 {
@@ -16,6 +24,8 @@ namespace adif
     while (len > 0)
     {
       unsigned char byte = is.get();
+      if (!is) // truncated value
+        break;
 
       if ((byte & 0x80) == 0x00) // ASCII: U+0000 to U+007F
       {
@@ -107,8 +117,8 @@ namespace adif
   {
     this->Clean();
     this->filename = filename;
-    std::ifstream file(filename);
-    if (!file)
+    auto file = openInput(filename);
+    if (!*file)
     {
       std::cerr << "[Error] Failed to open file: " + filename << std::endl;
       return;
@@ -116,7 +126,7 @@ namespace adif
 
     while (true)
     {
-      auto record = getRecord(file);
+      auto record = getRecord(*file);
       if (record.empty())
         break;
       records.push_back(record);
@@ -124,11 +134,117 @@ namespace adif
         field_names.insert(field.first);
     }
 
-    file.close();
     if (records.empty())
       std::cerr << "[Warning] No record found in file: " + filename << std::endl;
   }
 
+  unsigned getWorkerCount(size_t jobs)
+  {
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min<size_t>(workers, jobs));
+  }
+
+  bool matchPattern(const char *pattern, const char *name)
+  {
+    // glob matching supporting * and ?
+    if (*pattern == '\0')
+      return *name == '\0';
+    if (*pattern == '*')
+      return matchPattern(pattern + 1, name) || (*name != '\0' && matchPattern(pattern, name + 1));
+    if (*name == '\0' || (*pattern != '?' && *pattern != *name))
+      return false;
+    return matchPattern(pattern + 1, name + 1);
+  }
+
+  std::vector<std::string> expandPattern(const std::string &pattern)
+  {
+    namespace fs = std::filesystem;
+    std::vector<std::string> filenames;
+    fs::path path(pattern);
+    std::error_code ec;
+    if (fs::is_directory(path, ec))
+    {
+      for (const auto &entry : fs::directory_iterator(path, ec))
+      {
+        fs::path name = entry.path().filename();
+        if (name.extension() == ".gz" || name.extension() == ".zst")
+          name = name.stem();
+        std::string extension = name.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (entry.is_regular_file(ec) && (extension == ".adi" || extension == ".adif"))
+          filenames.push_back(entry.path().string());
+      }
+    }
+    else if (pattern.find_first_of("*?") == std::string::npos)
+    {
+      filenames.push_back(pattern);
+    }
+    else
+    {
+      fs::path parent = path.has_parent_path() ? path.parent_path() : fs::path(".");
+      std::string name = path.filename().string();
+      for (const auto &entry : fs::directory_iterator(parent, ec))
+        if (entry.is_regular_file(ec) && matchPattern(name.c_str(), entry.path().filename().string().c_str()))
+          filenames.push_back(path.has_parent_path() ? entry.path().string() : entry.path().filename().string());
+    }
+    std::sort(filenames.begin(), filenames.end());
+    return filenames;
+  }
+
+  std::vector<Document::Report> Document::OpenAll(const std::string &pattern)
+  {
+    this->Clean();
+    std::vector<std::string> filenames = expandPattern(pattern);
+    this->filename = pattern + " (" + std::to_string(filenames.size()) + " files)";
+    if (filenames.empty())
+    {
+      std::cerr << "[Error] No file matches: " + pattern << std::endl;
+      return {};
+    }
+
+    // load files on a pool of workers taking the next unread file
+    std::vector<Document> docs(filenames.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+      for (size_t i = next++; i < filenames.size(); i = next++)
+        docs[i].Open(filenames[i]);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned id = 1; id < getWorkerCount(filenames.size()); id++)
+      threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+      thread.join();
+
+    // merge in filename order, dropping records whose primary key came from
+    // an earlier file; repeated keys within one file are kept as in Open
+    std::vector<Report> reports;
+    std::unordered_set<std::string> keys;
+    for (size_t i = 0; i < docs.size(); i++)
+    {
+      Report report = {filenames[i], static_cast<unsigned>(docs[i].records.size()), 0};
+      std::vector<std::string> file_keys;
+      for (auto &record : docs[i].records)
+      {
+        std::string key = record["QSO_DATE"].second + '\x1f' + record["TIME_ON"].second;
+        if (keys.count(key))
+        {
+          report.duplicates++;
+          continue;
+        }
+        file_keys.push_back(std::move(key));
+        for (const auto &field : record)
+          field_names.insert(field.first);
+        records.push_back(std::move(record));
+      }
+      keys.insert(file_keys.begin(), file_keys.end());
+      docs[i].Clean();
+      reports.push_back(report);
+    }
+    return reports;
+  }
+
   Document::Document(const rapidcsv::Document &doc)
   {
     for (unsigned int row = 0; row < doc.GetRowCount(); row++)
@@ -165,13 +281,22 @@ namespace adif
 
   void Document::Save(const std::string &filename) const
   {
-    std::ofstream file(filename);
-    if (!file)
+    auto file = openOutput(filename);
+    if (!*file)
       throw std::runtime_error("Failed to open file: " + filename);
 
-    file << *this;
+    *file << *this;
+    closeOutput(*file, filename);
+  }
+
+  void Document::Export(const std::string &filename) const
+  {
+    auto file = openOutput(filename);
+    if (!*file)
+      throw std::runtime_error("Failed to open file: " + filename);
 
-    file.close();
+    this->GetCSV().Save(*file);
+    closeOutput(*file, filename);
   }
 
   void Document::Merge(const Document &doc)
@@ -205,6 +330,110 @@ namespace adif
     return conflicts;
   }
 
+  long long getTimestamp(const Record &record)
+  {
+    // seconds since 1970-01-01 of (QSO_DATE, TIME_ON), -1 if invalid
+    auto date = record.find("QSO_DATE");
+    auto time = record.find("TIME_ON");
+    if (date == record.end() || time == record.end())
+      return -1;
+    const std::string &d = date->second.second;
+    const std::string &t = time->second.second;
+    if (d.length() != 8 || (t.length() != 4 && t.length() != 6) ||
+        !std::all_of(d.begin(), d.end(), ::isdigit) || !std::all_of(t.begin(), t.end(), ::isdigit))
+      return -1;
+
+    long long y = std::stoi(d.substr(0, 4));
+    unsigned m = std::stoi(d.substr(4, 2));
+    unsigned day = std::stoi(d.substr(6, 2));
+    unsigned hour = std::stoi(t.substr(0, 2));
+    unsigned minute = std::stoi(t.substr(2, 2));
+    unsigned second = t.length() == 6 ? std::stoi(t.substr(4, 2)) : 0;
+    static const unsigned month_days[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    if (m < 1 || m > 12 || day < 1 || day > month_days[m - 1] || (m == 2 && day == 29 && !leap) ||
+        hour > 23 || minute > 59 || second > 59)
+      return -1;
+    // days from civil date, see http://howardhinnant.github.io/date_algorithms.html
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = static_cast<unsigned>(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long long days = era * 146097 + static_cast<long long>(doe) - 719468;
+
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+  }
+
+  std::vector<std::vector<int>> Document::DetectDuplicates(unsigned window) const
+  {
+    // union-find over record indexes, with path halving and union by size
+    std::vector<int> parent(records.size());
+    std::vector<int> size(records.size(), 1);
+    for (int i = 0; i < records.size(); i++)
+      parent[i] = i;
+    auto find = [&](int i)
+    {
+      while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+      return i;
+    };
+    auto unite = [&](int a, int b)
+    {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+        return;
+      if (size[a] < size[b])
+        std::swap(a, b);
+      parent[b] = a;
+      size[a] += size[b];
+    };
+
+    // (CALL, BAND, MODE, time / window) -> (timestamp, index)
+    std::unordered_map<std::string, std::vector<std::pair<long long, int>>> buckets;
+    long long width = std::max(1u, window);
+    for (int i = 0; i < records.size(); i++)
+    {
+      long long timestamp = getTimestamp(records[i]);
+      auto call = records[i].find("CALL");
+      if (timestamp < 0 || call == records[i].end())
+        continue;
+      std::string key = call->second.second;
+      for (const auto &name : {"BAND", "MODE"})
+      {
+        auto field = records[i].find(name);
+        key += '\x1f';
+        if (field != records[i].end())
+          key += field->second.second;
+      }
+      std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+      key += '\x1f';
+
+      long long bucket = timestamp / width;
+      for (long long b = bucket - 1; b <= bucket + 1; b++)
+      {
+        auto neighbour = buckets.find(key + std::to_string(b));
+        if (neighbour == buckets.end())
+          continue;
+        for (const auto &other : neighbour->second)
+          if (std::abs(other.first - timestamp) <= window)
+            unite(other.second, i);
+      }
+      buckets[key + std::to_string(bucket)].push_back({timestamp, i});
+    }
+
+    std::map<int, std::vector<int>> groups;
+    for (int i = 0; i < records.size(); i++)
+      groups[find(i)].push_back(i);
+    std::vector<std::vector<int>> clusters;
+    for (auto &group : groups)
+      if (group.second.size() > 1)
+        clusters.push_back(std::move(group.second));
+    std::sort(clusters.begin(), clusters.end());
+    return clusters;
+  }
+
   Record Document::operator[](int index) const
   {
     if (index < 0 || index >= records.size())
@@ -303,6 +532,90 @@ namespace adif
     return table;
   }
 
+  struct KeyHash
+  {
+    size_t operator()(const std::vector<std::string> &key) const
+    {
+      size_t seed = key.size();
+      for (const auto &value : key)
+        seed ^= std::hash<std::string>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+      return seed;
+    }
+  };
+
+  void mergeGroup(Document::Group &into, const Document::Group &from)
+  {
+    into.count += from.count;
+    for (const auto &field : from.distinct)
+      into.distinct[field.first].insert(field.second.begin(), field.second.end());
+    for (const auto &field : from.range)
+    {
+      auto range = into.range.find(field.first);
+      if (range == into.range.end())
+      {
+        into.range.insert(field);
+        continue;
+      }
+      range->second.first = std::min(range->second.first, field.second.first);
+      range->second.second = std::max(range->second.second, field.second.second);
+    }
+  }
+
+  Document::Statistics Document::Aggregate(const std::vector<std::string> &keys, const std::vector<std::string> &fields) const
+  {
+    using Table = std::unordered_map<std::vector<std::string>, Group, KeyHash>;
+    // at least 4096 records per worker, small logs stay on the calling thread
+    unsigned workers = getWorkerCount(records.size() / 4096 + 1);
+    std::vector<Table> tables(workers);
+
+    auto worker = [&](unsigned id)
+    {
+      Table &table = tables[id];
+      size_t begin = records.size() * id / workers;
+      size_t end = records.size() * (id + 1) / workers;
+      std::vector<std::string> key(keys.size());
+      for (size_t i = begin; i < end; i++)
+      {
+        const Record &record = records[i];
+        for (size_t k = 0; k < keys.size(); k++)
+        {
+          auto value = record.find(keys[k]);
+          key[k] = value != record.end() ? value->second.second : "";
+        }
+        Group &group = table[key];
+        group.count++;
+        for (const auto &field : fields)
+        {
+          auto value = record.find(field);
+          if (value == record.end())
+            continue;
+          const std::string &v = value->second.second;
+          group.distinct[field].insert(v);
+          auto range = group.range.find(field);
+          if (range == group.range.end())
+            group.range[field] = {v, v};
+          else if (v < range->second.first)
+            range->second.first = v;
+          else if (v > range->second.second)
+            range->second.second = v;
+        }
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned id = 1; id < workers; id++)
+      threads.emplace_back(worker, id);
+    worker(0);
+    for (auto &thread : threads)
+      thread.join();
+
+    Statistics statistics;
+    for (const auto &table : tables)
+      for (const auto &group : table)
+        mergeGroup(statistics[group.first], group.second);
+    return statistics;
+  }
+
   std::ostream &operator<<(std::ostream &os, const adif::Document &doc)
   {
     os << "File: " << doc.filename << std::endl
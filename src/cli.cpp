@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <functional>
 #include <memory>
+#include <set>
 #include <string>
 
 #include <vector>
@@ -43,6 +46,61 @@ bool checkTokens(const std::vector<std::string> &tokens, int n)
   }
 }
 
+size_t getBudget(const std::string &token)
+{
+  // memory budget given in MiB, returned in bytes
+  const unsigned long max = std::numeric_limits<size_t>::max() >> 20;
+  unsigned long mib = 0;
+  if (!token.empty() && std::all_of(token.begin(), token.end(), ::isdigit) && token.length() <= 19)
+    mib = std::stoul(token);
+  if (mib < 1 || mib > max)
+    throw std::out_of_range("Invalid memory budget: " + token + " (1 to " + std::to_string(max) + " MiB)");
+  return static_cast<size_t>(mib) << 20;
+}
+
+void printConflicts(const adif::Document::Conflict &conflicts)
+{
+  std::cout << "Conflicts: " << conflicts.first.size() << "\n"
+            << "--First file--\n";
+  for (const auto &index : conflicts.first)
+    std::cout << index << " ";
+  std::cout << "\n--Second file--\n";
+  for (const auto &index : conflicts.second)
+    std::cout << index << " ";
+  std::cout << "\n";
+}
+
+void resolveDuplicates(adif::Document &adifdoc, unsigned window)
+{
+  std::vector<std::vector<int>> clusters = adifdoc.DetectDuplicates(window);
+  if (clusters.empty())
+  {
+    std::cout << "No duplicates found.\n";
+    return;
+  }
+  std::cout << "[Warning] " << clusters.size() << " duplicate clusters detected.\n"
+            << "Index\tRecord\n";
+  for (int i = 0; i < clusters.size(); i++)
+  {
+    std::cout << "--Cluster " << i << "--\n";
+    for (const auto &index : clusters[i])
+    {
+      using adif::operator<<;
+      std::cout << index << "\t" << adifdoc[index];
+    }
+  }
+  std::cout << "Keep the first record of each cluster and delete the others? (y/n)\n"
+            << "(dedup)> ";
+  std::string answer;
+  std::getline(std::cin, answer);
+  if (answer != "y")
+    return;
+  std::vector<int> indexes;
+  for (const auto &cluster : clusters)
+    indexes.insert(indexes.end(), cluster.begin() + 1, cluster.end());
+  adifdoc.Delete(indexes);
+}
+
 int main(void)
 {
 
@@ -67,19 +125,38 @@ int main(void)
       std::cout << "Usage:\n"
                 << "  help: Display this help message.\n"
                 << "  read <file>: Read an ADIF file. If there is already data in memory, it will be cleared.\n"
+                << "  load <directory|pattern>: Read and merge all ADIF files in a directory or matching a pattern (* and ?), dropping records whose primary key appears in an earlier file.\n"
                 << "  display [index1 index2 ...]: Display records.\n"
                 << "  search <field> <value> [field value]...: Search records by field. Return indexes of all matched records.\n"
                 << "  update <index> <field> <value> [field value]...: Update records by field.\n"
                 << "  delete <index>: Delete records by field.\n"
-                << "  merge <file>: Merge another ADIF file into the current data.\n"
+                << "  merge <file> [window]: Merge another ADIF file into the current data. If window (seconds) is given, resolve fuzzy duplicates afterwards.\n"
+                << "  dedup <window>: Find records with the same CALL, BAND and MODE within window seconds and resolve them in bulk.\n"
+                << "  xconflicts <file1> <file2> [MiB]: Detect conflicts between two ADIF files out of core, using at most MiB (default 64) of key buffer.\n"
+                << "  xmerge <file1> <file2> <output> [MiB]: Merge two ADIF files out of core into output, dropping records of file2 conflicting with file1.\n"
                 << "  save <file>: Save data to a new ADIF file.\n"
                 << "  export <file>: Export data to a CSV file.\n"
+                << "  stats by <field>... [of <field>...]: Count records grouped by fields, with distinct count and min/max of other fields.\n"
                 << "  quit: Exit the program.\n";
     }
     else if (tokens[0] == "read" && checkTokens(tokens, 2))
     {
       adifdoc.Open(tokens[1]);
     }
+    else if (tokens[0] == "load" && checkTokens(tokens, 2))
+    {
+      std::vector<adif::Document::Report> reports = adifdoc.OpenAll(tokens[1]);
+      std::cout << "File\tRecords\tDuplicates\n";
+      unsigned records = 0, duplicates = 0;
+      for (const auto &report : reports)
+      {
+        std::cout << report.filename << "\t" << report.records << "\t" << report.duplicates << "\n";
+        records += report.records;
+        duplicates += report.duplicates;
+      }
+      std::cout << "Total: " << reports.size() << " files, " << records - duplicates << " records loaded, "
+                << duplicates << " duplicates dropped.\n";
+    }
     else if (tokens[0] == "display")
     {
       if (tokens.size() == 1)
@@ -135,7 +212,7 @@ int main(void)
         adifdoc.Delete(indexes);
       }
     }
-    else if (tokens[0] == "merge" && checkTokens(tokens, 2))
+    else if (tokens[0] == "merge" && (tokens.size() == 2 || checkTokens(tokens, 3)))
     {
       adif::Document doc(tokens[1]);
       while (adifdoc.DetectConflicts(doc).first.size() > 0)
@@ -176,15 +253,103 @@ int main(void)
       }
       std::cout << "Merging...\n";
       adifdoc.Merge(doc);
+      if (tokens.size() == 3)
+        resolveDuplicates(adifdoc, std::stoul(tokens[2]));
+    }
+    else if (tokens[0] == "dedup" && checkTokens(tokens, 2))
+    {
+      resolveDuplicates(adifdoc, std::stoul(tokens[1]));
+    }
+    else if (tokens[0] == "xconflicts" && (tokens.size() == 3 || checkTokens(tokens, 4)))
+    {
+      try
+      {
+        size_t budget = getBudget(tokens.size() == 4 ? tokens[3] : "64");
+        printConflicts(adif::Document::DetectConflicts(tokens[1], tokens[2], budget));
+      }
+      catch (const std::exception &e)
+      {
+        std::cerr << "[Error] " << e.what() << std::endl;
+      }
+    }
+    else if (tokens[0] == "xmerge" && (tokens.size() == 4 || checkTokens(tokens, 5)))
+    {
+      try
+      {
+        size_t budget = getBudget(tokens.size() == 5 ? tokens[4] : "64");
+        std::cout << "Merging...\n";
+        adif::Document::Conflict conflicts = adif::Document::Merge(tokens[1], tokens[2], tokens[3], budget);
+        printConflicts(conflicts);
+        std::set<int> dropped(conflicts.second.begin(), conflicts.second.end());
+        std::cout << dropped.size() << " conflicting records of " << tokens[2] << " dropped.\n";
+      }
+      catch (const std::exception &e)
+      {
+        std::cerr << "[Error] " << e.what() << std::endl;
+      }
     }
     else if (tokens[0] == "save" && checkTokens(tokens, 2))
     {
-      adifdoc.Save(tokens[1]);
+      try
+      {
+        adifdoc.Save(tokens[1]);
+      }
+      catch (const std::exception &e)
+      {
+        std::cerr << "[Error] " << e.what() << std::endl;
+      }
     }
     else if (tokens[0] == "export" && checkTokens(tokens, 2))
     {
-      rapidcsv::Document csvdoc = adifdoc.GetCSV();
-      csvdoc.Save(tokens[1]);
+      try
+      {
+        adifdoc.Export(tokens[1]);
+      }
+      catch (const std::exception &e)
+      {
+        std::cerr << "[Error] " << e.what() << std::endl;
+      }
+    }
+    else if (tokens[0] == "stats")
+    {
+      auto of = std::find(tokens.begin(), tokens.end(), "of");
+      if (tokens.size() <= 2 || tokens[1] != "by" || of == tokens.begin() + 2 || (of != tokens.end() && of + 1 == tokens.end()))
+      {
+        std::cout << "Invalid number of arguments.\n";
+        std::cout << "Usage: stats by <field>... [of <field>...]\n";
+      }
+      else
+      {
+        std::vector<std::string> keys(tokens.begin() + 2, of);
+        std::vector<std::string> fields(of == tokens.end() ? of : of + 1, tokens.end());
+        for (auto &field : keys)
+          std::transform(field.begin(), field.end(), field.begin(), ::toupper);
+        for (auto &field : fields)
+          std::transform(field.begin(), field.end(), field.begin(), ::toupper);
+
+        for (const auto &key : keys)
+          std::cout << key << "\t";
+        std::cout << "COUNT";
+        for (const auto &field : fields)
+          std::cout << "\t" << field << "_DISTINCT\t" << field << "_MIN\t" << field << "_MAX";
+        std::cout << "\n";
+        for (const auto &group : adifdoc.Aggregate(keys, fields))
+        {
+          for (const auto &value : group.first)
+            std::cout << value << "\t";
+          std::cout << group.second.count;
+          for (const auto &field : fields)
+          {
+            auto distinct = group.second.distinct.find(field);
+            auto range = group.second.range.find(field);
+            if (distinct == group.second.distinct.end())
+              std::cout << "\t0\t\t";
+            else
+              std::cout << "\t" << distinct->second.size() << "\t" << range->second.first << "\t" << range->second.second;
+          }
+          std::cout << "\n";
+        }
+      }
     }
     else if (tokens[0] == "quit")
     {
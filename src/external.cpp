@@ -0,0 +1,354 @@
+#include "adif.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace adif
+{
+  /**
+   * @brief Primary key of a record and where it comes from
+   *
+   * source is 0 for the left file and 1 for the right file, index is the
+   * position of the record in its file as Document::Open would number it.
+   */
+  struct Entry
+  {
+    std::string qso_date;
+    std::string time_on;
+    unsigned source;
+    unsigned index;
+
+    bool operator>(const Entry &other) const
+    {
+      return std::tie(qso_date, time_on, source, index) >
+             std::tie(other.qso_date, other.time_on, other.source, other.index);
+    }
+  };
+
+  void writeString(std::ostream &os, const std::string &value)
+  {
+    uint32_t size = value.size();
+    os.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    os.write(value.data(), size);
+  }
+
+  bool readString(std::istream &is, std::string &value)
+  {
+    uint32_t size;
+    if (!is.read(reinterpret_cast<char *>(&size), sizeof(size)))
+      return false;
+    value.resize(size);
+    return bool(is.read(&value[0], size));
+  }
+
+  void writeEntry(std::ostream &os, const Entry &entry)
+  {
+    writeString(os, entry.qso_date);
+    writeString(os, entry.time_on);
+    os.write(reinterpret_cast<const char *>(&entry.source), sizeof(entry.source));
+    os.write(reinterpret_cast<const char *>(&entry.index), sizeof(entry.index));
+  }
+
+  bool readEntry(std::istream &is, Entry &entry)
+  {
+    return readString(is, entry.qso_date) && readString(is, entry.time_on) &&
+           is.read(reinterpret_cast<char *>(&entry.source), sizeof(entry.source)) &&
+           is.read(reinterpret_cast<char *>(&entry.index), sizeof(entry.index));
+  }
+
+  const size_t MAX_FAN_IN = 32;
+  const size_t MIN_MEMORY_BUDGET = 1 << 9;
+
+  /**
+   * @brief Sorted runs of primary keys spilled to temporary files
+   *
+   * Keys are buffered until the memory budget is reached, then sorted and
+   * written to a new run. Runs are merged at most MAX_FAN_IN at a time, so
+   * the number of open files stays bounded. The run files are removed on
+   * destruction.
+   */
+  class Runs
+  {
+  public:
+    Runs(size_t memory_budget) : budget(memory_budget)
+    {
+      if (budget < MIN_MEMORY_BUDGET)
+        throw std::invalid_argument("Memory budget too small: " + std::to_string(budget) + " bytes, at least " +
+                                    std::to_string(MIN_MEMORY_BUDGET) + " required");
+      std::random_device random;
+      prefix = (std::filesystem::temp_directory_path() / ("adif-" + std::to_string(random()) + "-")).string();
+    }
+
+    ~Runs()
+    {
+      std::error_code ec;
+      for (const auto &run : created)
+        std::filesystem::remove(run, ec);
+    }
+
+    void Add(Entry &&entry)
+    {
+      used += sizeof(Entry) + entry.qso_date.size() + entry.time_on.size();
+      buffer.push_back(std::move(entry));
+      if (used >= budget)
+        Spill();
+    }
+
+    void Spill()
+    {
+      if (buffer.empty())
+        return;
+      std::sort(buffer.begin(), buffer.end(), [](const Entry &a, const Entry &b)
+                { return b > a; });
+      std::ofstream file(NewRun(), std::ios::binary);
+      if (!file)
+        throw std::runtime_error("Failed to create temporary file: " + runs.back());
+      for (const auto &entry : buffer)
+        writeEntry(file, entry);
+      if (!file)
+        throw std::runtime_error("Failed to write temporary file: " + runs.back());
+      buffer.clear();
+      buffer.shrink_to_fit();
+      used = 0;
+    }
+
+    /**
+     * @brief Visit all spilled entries in ascending order
+     *
+     * Runs are first merged in passes of MAX_FAN_IN until at most MAX_FAN_IN
+     * runs are left, which are then merged into visit.
+     */
+    void Merge(const std::function<void(const Entry &)> &visit)
+    {
+      while (runs.size() > MAX_FAN_IN)
+      {
+        std::vector<std::string> inputs;
+        inputs.swap(runs);
+        for (size_t begin = 0; begin < inputs.size(); begin += MAX_FAN_IN)
+        {
+          std::vector<std::string> group(inputs.begin() + begin, inputs.begin() + std::min(begin + MAX_FAN_IN, inputs.size()));
+          if (group.size() == 1)
+          {
+            runs.push_back(group.front());
+            continue;
+          }
+          std::ofstream file(NewRun(), std::ios::binary);
+          if (!file)
+            throw std::runtime_error("Failed to create temporary file: " + runs.back());
+          MergeFiles(group, [&file](const Entry &entry)
+                     { writeEntry(file, entry); });
+          if (!file)
+            throw std::runtime_error("Failed to write temporary file: " + runs.back());
+          std::error_code ec;
+          for (const auto &run : group)
+            std::filesystem::remove(run, ec);
+        }
+      }
+      MergeFiles(runs, visit);
+    }
+
+  private:
+    const std::string &NewRun()
+    {
+      created.push_back(prefix + std::to_string(created.size()) + ".run");
+      runs.push_back(created.back());
+      return runs.back();
+    }
+
+    static void MergeFiles(const std::vector<std::string> &names, const std::function<void(const Entry &)> &visit)
+    {
+      // k-way merge of sorted runs
+      std::vector<std::ifstream> files;
+      for (const auto &name : names)
+      {
+        files.emplace_back(name, std::ios::binary);
+        if (!files.back())
+          throw std::runtime_error("Failed to open temporary file: " + name);
+      }
+      using Head = std::pair<Entry, size_t>;
+      auto greater = [](const Head &a, const Head &b)
+      { return a.first > b.first; };
+      std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+      for (size_t i = 0; i < files.size(); i++)
+      {
+        Entry entry;
+        if (readEntry(files[i], entry))
+          heads.push({std::move(entry), i});
+      }
+      while (!heads.empty())
+      {
+        Head head = heads.top();
+        heads.pop();
+        visit(head.first);
+        Entry entry;
+        if (readEntry(files[head.second], entry))
+          heads.push({std::move(entry), head.second});
+      }
+      for (size_t i = 0; i < files.size(); i++)
+        if (files[i].bad())
+          throw std::runtime_error("Failed to read temporary file: " + names[i]);
+    }
+
+    size_t budget;
+    size_t used = 0;
+    std::string prefix;
+    std::vector<Entry> buffer;
+    std::vector<std::string> runs;
+    std::vector<std::string> created;
+  };
+
+  Record readRecord(std::istream &is, const std::string &filename)
+  {
+    try
+    {
+      return getRecord(is);
+    }
+    catch (const std::exception &e)
+    {
+      // corrupted compressed input explains garbage records best
+      closeInput(is, filename);
+      throw std::runtime_error("Invalid ADIF in " + filename + ": " + e.what());
+    }
+  }
+
+  /**
+   * @brief Stream an ADIF file and add the primary key of each record to runs
+   *
+   * @return unsigned number of records, reading stops at the first invalid
+   * record like Document::Open
+   */
+  unsigned spillKeys(const std::string &filename, unsigned source, Runs &runs)
+  {
+    auto file = openInput(filename);
+    if (!*file)
+      throw std::runtime_error("Failed to open file: " + filename);
+    unsigned index = 0;
+    while (true)
+    {
+      auto record = readRecord(*file, filename);
+      if (record.empty())
+        break;
+      runs.Add({record["QSO_DATE"].second, record["TIME_ON"].second, source, index++});
+    }
+    closeInput(*file, filename);
+    return index;
+  }
+
+  Document::Conflict mergeRuns(Runs &runs)
+  {
+    // entries of the same key arrive together, left before right, by index
+    std::vector<std::pair<int, size_t>> lefts; // (left index, group)
+    std::vector<std::vector<int>> groups;      // right indexes of a conflicting key
+    std::vector<int> left, right;
+    auto flush = [&]()
+    {
+      if (!left.empty() && !right.empty())
+      {
+        for (const auto &index : left)
+          lefts.push_back({index, groups.size()});
+        groups.push_back(right);
+      }
+      left.clear();
+      right.clear();
+    };
+    Entry last;
+    runs.Merge([&](const Entry &entry)
+               {
+      if (entry.qso_date != last.qso_date || entry.time_on != last.time_on)
+        flush();
+      (entry.source == 0 ? left : right).push_back(entry.index);
+      last = entry; });
+    flush();
+
+    // same order as Document::DetectConflicts: by left index
+    std::sort(lefts.begin(), lefts.end());
+    Document::Conflict conflicts;
+    for (const auto &left : lefts)
+    {
+      conflicts.first.push_back(left.first);
+      const auto &group = groups[left.second];
+      conflicts.second.insert(conflicts.second.end(), group.begin(), group.end());
+    }
+    return conflicts;
+  }
+
+  Document::Conflict Document::DetectConflicts(const std::string &lhs, const std::string &rhs, size_t memory_budget)
+  {
+    Runs runs(memory_budget);
+    spillKeys(lhs, 0, runs);
+    spillKeys(rhs, 1, runs);
+    runs.Spill();
+    return mergeRuns(runs);
+  }
+
+  Document::Conflict Document::Merge(const std::string &lhs, const std::string &rhs, const std::string &output, size_t memory_budget)
+  {
+    Runs runs(memory_budget);
+    unsigned lhs_count = spillKeys(lhs, 0, runs);
+    unsigned rhs_count = spillKeys(rhs, 1, runs);
+    runs.Spill();
+    Conflict conflicts = mergeRuns(runs);
+
+    // records of rhs conflicting with lhs are dropped
+    std::vector<int> dropped = conflicts.second;
+    std::sort(dropped.begin(), dropped.end());
+    dropped.erase(std::unique(dropped.begin(), dropped.end()), dropped.end());
+
+    // write to a temporary file next to output, so output may be an input
+    namespace fs = std::filesystem;
+    fs::path target(output);
+    std::random_device random;
+    fs::path temporary = target.parent_path() / (".adif-" + std::to_string(random()) + "-" + target.filename().string());
+    try
+    {
+      auto file = openOutput(temporary.string());
+      if (!*file)
+        throw std::runtime_error("Failed to open file: " + temporary.string());
+      *file << "File: " << lhs << " + " << rhs << std::endl
+            << "Records: " << lhs_count + rhs_count - dropped.size() << std::endl
+            << "<EOH>" << std::endl;
+      for (unsigned source = 0; source < 2; source++)
+      {
+        const std::string &filename = source == 0 ? lhs : rhs;
+        auto input = openInput(filename);
+        if (!*input)
+          throw std::runtime_error("Failed to open file: " + filename);
+        auto skip = dropped.begin();
+        for (int index = 0;; index++)
+        {
+          auto record = readRecord(*input, filename);
+          if (record.empty())
+            break;
+          if (source == 1 && skip != dropped.end() && *skip == index)
+          {
+            skip++;
+            continue;
+          }
+          *file << record;
+        }
+        closeInput(*input, filename);
+      }
+      closeOutput(*file, output);
+      file.reset();
+      fs::rename(temporary, target);
+    }
+    catch (...)
+    {
+      std::error_code ec;
+      fs::remove(temporary, ec);
+      throw;
+    }
+    return conflicts;
+  }
+
+} // namespace adif
@@ -0,0 +1,461 @@
+#include "stream.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef ADIF_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ADIF_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace adif
+{
+  const size_t CHUNK_SIZE = 1 << 16;
+  const size_t QUEUE_CAPACITY = 8;
+
+  using Sink = std::function<bool(std::string &&)>;
+  // returns false if the input is corrupted or truncated
+  using Decoder = bool (*)(std::istream &, const Sink &);
+
+  /**
+   * @brief Stream buffer reading chunks produced by a decoder thread
+   *
+   * The decoder pushes decompressed chunks into a bounded queue, so reading the
+   * file and decompressing overlaps with parsing.
+   */
+  class DecodeBuffer : public std::streambuf
+  {
+  public:
+    DecodeBuffer(std::unique_ptr<std::istream> file, Decoder decode) : file(std::move(file))
+    {
+      worker = std::thread([this, decode]()
+                           {
+        bool ok = decode(*this->file, [this](std::string &&chunk) { return push(std::move(chunk)); });
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = !ok;
+        done = true;
+        ready.notify_all(); });
+    }
+
+    ~DecodeBuffer()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+      }
+      space.notify_all();
+      worker.join();
+    }
+
+    /**
+     * @brief Whether the decoder stopped on corrupted or truncated input
+     */
+    bool Failed()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return failed;
+    }
+
+  protected:
+    int_type underflow() override
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [this]()
+                 { return !chunks.empty() || done; });
+      if (chunks.empty())
+        return traits_type::eof();
+      current = std::move(chunks.front());
+      chunks.pop_front();
+      space.notify_one();
+      setg(&current[0], &current[0], &current[0] + current.size());
+      return traits_type::to_int_type(*gptr());
+    }
+
+  private:
+    bool push(std::string &&chunk)
+    {
+      if (chunk.empty())
+        return true;
+      std::unique_lock<std::mutex> lock(mutex);
+      space.wait(lock, [this]()
+                 { return chunks.size() < QUEUE_CAPACITY || cancelled; });
+      if (cancelled)
+        return false;
+      chunks.push_back(std::move(chunk));
+      ready.notify_one();
+      return true;
+    }
+
+    std::unique_ptr<std::istream> file;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable ready, space;
+    std::deque<std::string> chunks;
+    std::string current;
+    bool done = false;
+    bool failed = false;
+    bool cancelled = false;
+  };
+
+  class DecodeStream : public std::istream
+  {
+  public:
+    DecodeStream(std::unique_ptr<std::istream> file, Decoder decode)
+        : std::istream(nullptr), buffer(std::move(file), decode)
+    {
+      rdbuf(&buffer);
+    }
+
+    bool Failed() { return buffer.Failed(); }
+
+  private:
+    DecodeBuffer buffer;
+  };
+
+  /**
+   * @brief Stream buffer compressing its content into a file
+   *
+   * Derived classes must call finish() in their destructor, in case Finish()
+   * was not called explicitly.
+   */
+  class EncodeBuffer : public std::streambuf
+  {
+  public:
+    EncodeBuffer(std::unique_ptr<std::ofstream> file) : file(std::move(file)), buffer(CHUNK_SIZE), output(CHUNK_SIZE)
+    {
+      setp(buffer.data(), buffer.data() + buffer.size());
+    }
+    virtual ~EncodeBuffer() = default;
+
+    /**
+     * @brief End the compressed stream and close the file
+     *
+     * @return bool false if compressing, writing or closing failed
+     */
+    bool Finish()
+    {
+      if (!finished)
+      {
+        finished = true;
+        failed = !encode(pbase(), pptr() - pbase(), true);
+        setp(buffer.data(), buffer.data() + buffer.size());
+        file->close();
+        failed = failed || file->fail();
+      }
+      return !failed;
+    }
+
+  protected:
+    int_type overflow(int_type ch) override
+    {
+      if (finished || !encode(pbase(), pptr() - pbase(), false))
+        return traits_type::eof();
+      setp(buffer.data(), buffer.data() + buffer.size());
+      if (!traits_type::eq_int_type(ch, traits_type::eof()))
+      {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+      }
+      return traits_type::not_eof(ch);
+    }
+
+    int sync() override
+    {
+      if (finished || !encode(pbase(), pptr() - pbase(), false))
+        return -1;
+      setp(buffer.data(), buffer.data() + buffer.size());
+      return file->flush() ? 0 : -1;
+    }
+
+    void finish()
+    {
+      if (!finished && !Finish())
+        std::cerr << "[Error] Failed to finish compressed stream" << std::endl;
+    }
+
+    virtual bool encode(const char *data, size_t size, bool end) = 0;
+
+    std::unique_ptr<std::ofstream> file;
+    std::vector<char> buffer;
+    std::vector<char> output;
+    bool finished = false;
+    bool failed = false;
+  };
+
+  class EncodeStream : public std::ostream
+  {
+  public:
+    EncodeStream(std::unique_ptr<EncodeBuffer> buffer) : std::ostream(buffer.get()), buffer(std::move(buffer)) {}
+
+    bool Close()
+    {
+      bool finished = buffer->Finish();
+      bool ok = !fail() && finished;
+      if (!ok)
+        setstate(std::ios::badbit);
+      return ok;
+    }
+
+  private:
+    std::unique_ptr<EncodeBuffer> buffer;
+  };
+
+#ifdef ADIF_WITH_ZLIB
+  bool decodeGzip(std::istream &is, const Sink &push)
+  {
+    z_stream zs = {};
+    // 15 + 32: maximum window, detect gzip or zlib header
+    if (inflateInit2(&zs, 15 + 32) != Z_OK)
+    {
+      std::cerr << "[Error] Failed to initialize gzip decoder" << std::endl;
+      return false;
+    }
+    std::vector<char> input(CHUNK_SIZE);
+    bool ended = false;
+    bool ok = true;
+    while (true)
+    {
+      if (zs.avail_in == 0)
+      {
+        is.read(input.data(), input.size());
+        zs.avail_in = is.gcount();
+        zs.next_in = reinterpret_cast<Bytef *>(input.data());
+        if (zs.avail_in == 0)
+        {
+          if (!ended)
+            std::cerr << "[Warning] Truncated gzip stream" << std::endl;
+          ok = ended && !is.bad();
+          break;
+        }
+      }
+      std::string output(CHUNK_SIZE, '\0');
+      zs.next_out = reinterpret_cast<Bytef *>(&output[0]);
+      zs.avail_out = output.size();
+      int ret = inflate(&zs, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END)
+      {
+        std::cerr << "[Error] Corrupted gzip stream: " << (zs.msg ? zs.msg : std::to_string(ret)) << std::endl;
+        ok = false;
+        break;
+      }
+      ended = ret == Z_STREAM_END;
+      if (ended) // concatenated gzip members
+        inflateReset(&zs);
+      output.resize(output.size() - zs.avail_out);
+      if (!push(std::move(output)))
+        break;
+    }
+    inflateEnd(&zs);
+    return ok;
+  }
+
+  class GzipBuffer : public EncodeBuffer
+  {
+  public:
+    GzipBuffer(std::unique_ptr<std::ofstream> file) : EncodeBuffer(std::move(file))
+    {
+      // 15 + 16: maximum window, write gzip header
+      if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error("Failed to initialize gzip encoder");
+    }
+
+    ~GzipBuffer()
+    {
+      finish();
+      deflateEnd(&zs);
+    }
+
+  protected:
+    bool encode(const char *data, size_t size, bool end) override
+    {
+      zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+      zs.avail_in = size;
+      do
+      {
+        zs.next_out = reinterpret_cast<Bytef *>(output.data());
+        zs.avail_out = output.size();
+        if (deflate(&zs, end ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR)
+          return false;
+        file->write(output.data(), output.size() - zs.avail_out);
+      } while (zs.avail_out == 0);
+      return bool(*file);
+    }
+
+  private:
+    z_stream zs = {};
+  };
+#endif
+
+#ifdef ADIF_WITH_ZSTD
+  bool decodeZstd(std::istream &is, const Sink &push)
+  {
+    ZSTD_DCtx *ctx = ZSTD_createDCtx();
+    std::vector<char> input(ZSTD_DStreamInSize());
+    size_t ret = 0;
+    while (is.read(input.data(), input.size()) || is.gcount() > 0)
+    {
+      ZSTD_inBuffer in = {input.data(), static_cast<size_t>(is.gcount()), 0};
+      while (in.pos < in.size)
+      {
+        std::string output(ZSTD_DStreamOutSize(), '\0');
+        ZSTD_outBuffer out = {&output[0], output.size(), 0};
+        ret = ZSTD_decompressStream(ctx, &out, &in);
+        if (ZSTD_isError(ret))
+        {
+          std::cerr << "[Error] Corrupted zstd stream: " << ZSTD_getErrorName(ret) << std::endl;
+          ZSTD_freeDCtx(ctx);
+          return false;
+        }
+        output.resize(out.pos);
+        if (!push(std::move(output)))
+        {
+          ZSTD_freeDCtx(ctx);
+          return true;
+        }
+      }
+    }
+    if (ret != 0)
+      std::cerr << "[Warning] Truncated zstd stream" << std::endl;
+    ZSTD_freeDCtx(ctx);
+    return ret == 0 && !is.bad();
+  }
+
+  class ZstdBuffer : public EncodeBuffer
+  {
+  public:
+    ZstdBuffer(std::unique_ptr<std::ofstream> file) : EncodeBuffer(std::move(file))
+    {
+      if (!ctx)
+        throw std::runtime_error("Failed to initialize zstd encoder");
+    }
+
+    ~ZstdBuffer()
+    {
+      finish();
+      ZSTD_freeCCtx(ctx);
+    }
+
+  protected:
+    bool encode(const char *data, size_t size, bool end) override
+    {
+      ZSTD_inBuffer in = {data, size, 0};
+      bool done = false;
+      while (!done)
+      {
+        ZSTD_outBuffer out = {output.data(), output.size(), 0};
+        size_t remaining = ZSTD_compressStream2(ctx, &out, &in, end ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(remaining))
+          return false;
+        file->write(output.data(), out.pos);
+        done = end ? remaining == 0 : in.pos == in.size;
+      }
+      return bool(*file);
+    }
+
+  private:
+    ZSTD_CCtx *ctx = ZSTD_createCCtx();
+  };
+#endif
+
+  bool hasSuffix(const std::string &value, const std::string &suffix)
+  {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  std::unique_ptr<std::istream> openInput(const std::string &filename)
+  {
+    auto file = std::make_unique<std::ifstream>(filename, std::ios::binary);
+    if (!*file)
+      return file;
+
+    // detect compression by magic bytes
+    unsigned char magic[4] = {};
+    file->read(reinterpret_cast<char *>(magic), sizeof(magic));
+    file->clear();
+    file->seekg(0);
+    if (magic[0] == 0x1f && magic[1] == 0x8b)
+    {
+#ifdef ADIF_WITH_ZLIB
+      return std::make_unique<DecodeStream>(std::move(file), decodeGzip);
+#else
+      std::cerr << "[Error] gzip support not compiled in: " + filename << std::endl;
+      file->setstate(std::ios::failbit);
+#endif
+    }
+    else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+    {
+#ifdef ADIF_WITH_ZSTD
+      return std::make_unique<DecodeStream>(std::move(file), decodeZstd);
+#else
+      std::cerr << "[Error] zstd support not compiled in: " + filename << std::endl;
+      file->setstate(std::ios::failbit);
+#endif
+    }
+    return file;
+  }
+
+  std::unique_ptr<std::ostream> openOutput(const std::string &filename)
+  {
+    // check compression support before the file is created or truncated
+    bool gzip = hasSuffix(filename, ".gz");
+    bool zstd = hasSuffix(filename, ".zst");
+#ifndef ADIF_WITH_ZLIB
+    if (gzip)
+      throw std::runtime_error("gzip support not compiled in: " + filename);
+#endif
+#ifndef ADIF_WITH_ZSTD
+    if (zstd)
+      throw std::runtime_error("zstd support not compiled in: " + filename);
+#endif
+
+    auto file = std::make_unique<std::ofstream>(filename, gzip || zstd ? std::ios::binary : std::ios::out);
+    if (!*file)
+      return file;
+#ifdef ADIF_WITH_ZLIB
+    if (gzip)
+      return std::make_unique<EncodeStream>(std::make_unique<GzipBuffer>(std::move(file)));
+#endif
+#ifdef ADIF_WITH_ZSTD
+    if (zstd)
+      return std::make_unique<EncodeStream>(std::make_unique<ZstdBuffer>(std::move(file)));
+#endif
+    return file;
+  }
+
+  void closeInput(std::istream &is, const std::string &filename)
+  {
+    auto *decoded = dynamic_cast<DecodeStream *>(&is);
+    if ((decoded && decoded->Failed()) || is.bad())
+      throw std::runtime_error("Corrupted or truncated file: " + filename);
+  }
+
+  void closeOutput(std::ostream &os, const std::string &filename)
+  {
+    bool ok;
+    if (auto *encoded = dynamic_cast<EncodeStream *>(&os))
+    {
+      ok = encoded->Close();
+    }
+    else if (auto *file = dynamic_cast<std::ofstream *>(&os))
+    {
+      ok = bool(file->flush());
+      file->close();
+      ok = ok && !file->fail();
+    }
+    else
+    {
+      ok = bool(os.flush());
+    }
+    if (!ok)
+      throw std::runtime_error("Failed to write file: " + filename);
+  }
+
+} // namespace adif